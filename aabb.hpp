@@ -0,0 +1,83 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "common.hpp"
+
+#include <algorithm>
+
+// axis-aligned bounding box
+class AABB {
+    public:
+        AABB() {}
+        AABB(const Point3 &a, const Point3 &b) : minimum(a), maximum(b) {}
+
+        // a box that contains nothing, the identity of surrounding_box()
+        static AABB empty() {
+            return AABB(Point3(infinity, infinity, infinity), Point3(-infinity, -infinity, -infinity));
+        }
+
+        Point3 min() const { return minimum; }
+        Point3 max() const { return maximum; }
+
+        Vec3 extent() const { return maximum - minimum; }
+        Point3 center() const { return 0.5 * (minimum + maximum); }
+
+        // clip the range [t_min, t_max] of the ray to the box
+        // return false if nothing of the range is left
+        bool clip(const Ray &r, double &t_min, double &t_max) const {
+            for (int a = 0; a < 3; a++) {
+                double inv_d = 1.0 / r.direction()[a];
+                double t0 = (minimum[a] - r.origin()[a]) * inv_d;
+                double t1 = (maximum[a] - r.origin()[a]) * inv_d;
+                if (inv_d < 0.0) std::swap(t0, t1);
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max < t_min) return false;
+            }
+            return true;
+        }
+
+        // the same with the inverse of the direction computed once per ray
+        bool clip(const Point3 &origin, const Vec3 &inv_d, double &t_min, double &t_max) const {
+            for (int a = 0; a < 3; a++) {
+                double t0 = (minimum[a] - origin[a]) * inv_d[a];
+                double t1 = (maximum[a] - origin[a]) * inv_d[a];
+                double t_near = t0 < t1 ? t0 : t1;
+                double t_far = t0 < t1 ? t1 : t0;
+                t_min = t_near > t_min ? t_near : t_min;
+                t_max = t_far < t_max ? t_far : t_max;
+            }
+            return t_min <= t_max;
+        }
+
+        bool hit(const Ray &r, double t_min, double t_max) const {
+            return clip(r, t_min, t_max);
+        }
+
+        bool operator==(const AABB &b) const {
+            for (int a = 0; a < 3; a++) {
+                if (minimum[a] != b.minimum[a] || maximum[a] != b.maximum[a]) return false;
+            }
+            return true;
+        }
+
+        double surface_area() const {
+            Vec3 d = extent();
+            return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+        }
+
+    public:
+        Point3 minimum;
+        Point3 maximum;
+};
+
+inline AABB surrounding_box(const AABB &a, const AABB &b) {
+    // plain comparisons instead of fmin/fmax, which are library calls without -ffast-math
+    const double *a0 = a.minimum.e, *a1 = a.maximum.e, *b0 = b.minimum.e, *b1 = b.maximum.e;
+    return AABB(
+        Point3(a0[0] < b0[0] ? a0[0] : b0[0], a0[1] < b0[1] ? a0[1] : b0[1], a0[2] < b0[2] ? a0[2] : b0[2]),
+        Point3(a1[0] > b1[0] ? a1[0] : b1[0], a1[1] > b1[1] ? a1[1] : b1[1], a1[2] > b1[2] ? a1[2] : b1[2])
+    );
+}
+
+#endif
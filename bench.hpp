@@ -0,0 +1,67 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// scenes and helpers shared by the benchmarks
+#include "common.hpp"
+#include "sphere.hpp"
+#include "hittable_list.hpp"
+#include "material.hpp"
+#include "render.hpp"
+
+#include <vector>
+
+// small spheres spread evenly over the ground, like random_scene()
+HitTableList uniform_scene(int n, shared_ptr<Material> mat) {
+    HitTableList world;
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, mat));
+    // a hollow sphere, its negative radius flips the normals inward
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), -0.9, mat));
+    double half = 0.5 * sqrt(double(n));
+    for (int k = 0; k < n; k++) {
+        Point3 center(rand_double(-half, half), 0.2, rand_double(-half, half));
+        world.add(make_shared<Sphere>(center, 0.2, mat));
+    }
+    return world;
+}
+
+// the same number of spheres packed into a few dense clusters
+HitTableList clustered_scene(int n, shared_ptr<Material> mat) {
+    HitTableList world;
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, mat));
+    // and the hollow sphere of uniform_scene()
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), -0.9, mat));
+    double half = 0.5 * sqrt(double(n));
+    const int n_clusters = 8;
+    Point3 centers[n_clusters];
+    for (int c = 0; c < n_clusters; c++) {
+        centers[c] = Point3(rand_double(-half, half), rand_double(0.5, 3), rand_double(-half, half));
+    }
+    for (int k = 0; k < n; k++) {
+        Point3 center = centers[k % n_clusters] + 0.05 * half * random_in_unit_sphere();
+        world.add(make_shared<Sphere>(center, 0.2, mat));
+    }
+    return world;
+}
+
+// trace the primary rays and return the rays per second
+// checksum sums the hit distances, so that the structures can be compared
+double trace(const HitTable &world, const std::vector<Ray> &rays, double &checksum) {
+    RenderClock::time_point start = RenderClock::now();
+    hit_record rec;
+    checksum = 0.0;
+    for (const Ray &r : rays) {
+        if (world.hit(r, 0.0001, infinity, rec)) checksum += rec.t;
+    }
+    return rays.size() / seconds_since(start);
+}
+
+// random primary rays of a camera looking over the scenes above
+std::vector<Ray> primary_rays(int n, int n_spheres) {
+    double half = 0.5 * sqrt(double(n_spheres));
+    Camera camera(Point3(1.2 * half, 0.4 * half, 1.2 * half), Point3(0, 0, 0), Vec3(0, 1, 0), 40.0, 1.5, 0.0, 1.0);
+    std::vector<Ray> rays;
+    for (int k = 0; k < n; k++) rays.push_back(camera.get_ray(rand_double(), rand_double()));
+    return rays;
+}
+
+#endif
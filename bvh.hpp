@@ -0,0 +1,482 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "common.hpp"
+#include "hittable.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// default for BVH::rebuild_if_degraded(), on 50000 moving spheres the trace rate has
+// dropped by about 15% when degradation() reaches it
+const double bvh_max_degradation = 1.2;
+
+// bounding volume hierarchy with one object per leaf
+// the tree is built top-down with binned SAH, and can then be changed incrementally:
+// objects are inserted, removed, or refitted after they moved, and quality() tells
+// how far the tree has drifted from a fresh build
+class BVH : public HitTable {
+    public:
+        BVH() {}
+        BVH(const std::vector<shared_ptr<HitTable>> &scene_objects, int threads = 1);
+
+        virtual bool hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+        virtual bool bounding_box(AABB &output_box) const override;
+
+        // rebuild the whole tree from the live objects
+        void build(int threads = 1);
+
+        // add an object and return its handle, which stays valid across rebuilds
+        int insert(shared_ptr<HitTable> object);
+        // remove() and update() ignore handles that were never returned by insert() or
+        // have already been removed
+        void remove(int handle);
+        // refit the path to the root after the object with this handle moved
+        void update(int handle);
+        // refit every node, cheaper than many update() calls after a large change
+        void refit();
+
+        // SAH cost of the inner nodes below the root relative to the summed leaf area, lower
+        // is better; the root is left out, its area is set by the largest objects, like a
+        // ground sphere, and would hide the drift of the nodes below
+        double quality() const;
+        // quality() relative to the last build
+        double degradation() const;
+        // rebuild if degradation() exceeds max_degradation, return true if it did
+        bool rebuild_if_degraded(double max_degradation = bvh_max_degradation, int threads = 1);
+
+        int size() const { return n_objects; }
+
+    private:
+        struct Node {
+            AABB box;
+            int parent;
+            int left;
+            int right;
+            // index into objects for a leaf, -1 for an inner node
+            int object;
+        };
+
+        struct BuildPrim {
+            AABB box;
+            Point3 centroid;
+            int object;
+        };
+
+        bool is_live(int handle) const;
+        AABB object_box(int handle) const;
+        int alloc_node();
+        void free_node(int node);
+        void set_box(int node, const AABB &box);
+        void refit_up(int node);
+        AABB refit_node(int node);
+        int build_range(std::vector<BuildPrim> &prims, int begin, int end, int parent, int threads);
+        bool hit_node(int node, const Ray &r, const Vec3 &inv_d, double t_min, double &t_max, hit_record &rec) const;
+
+    public:
+        std::vector<shared_ptr<HitTable>> objects;
+
+    private:
+        std::vector<Node> nodes;
+        // leaf_of[handle] is the leaf node holding objects[handle]
+        std::vector<int> leaf_of;
+        std::vector<int> free_nodes;
+        std::vector<int> free_handles;
+        std::atomic<int> n_built_nodes{0};
+        int root = -1;
+        int n_objects = 0;
+        // surface area of all inner and of all leaf nodes, kept up to date by set_box()
+        double inner_area = 0.0;
+        double leaf_area = 0.0;
+        double built_quality = 0.0;
+};
+
+BVH::BVH(const std::vector<shared_ptr<HitTable>> &scene_objects, int threads) {
+    objects = scene_objects;
+    leaf_of.assign(objects.size(), -1);
+    n_objects = static_cast<int>(objects.size());
+    build(threads);
+}
+
+AABB BVH::object_box(int handle) const {
+    AABB box;
+    // objects without a box get a huge one, so that every ray visits them
+    // it stays finite to keep the surface areas usable
+    if (!objects[handle]->bounding_box(box)) {
+        box = AABB(Point3(-1e30, -1e30, -1e30), Point3(1e30, 1e30, 1e30));
+    }
+    return box;
+}
+
+int BVH::alloc_node() {
+    if (!free_nodes.empty()) {
+        int node = free_nodes.back();
+        free_nodes.pop_back();
+        return node;
+    }
+    nodes.push_back(Node());
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+void BVH::free_node(int node) {
+    (nodes[node].object < 0 ? inner_area : leaf_area) -= nodes[node].box.surface_area();
+    nodes[node].object = -1;
+    nodes[node].left = nodes[node].right = nodes[node].parent = -1;
+    nodes[node].box = AABB();
+    free_nodes.push_back(node);
+}
+
+void BVH::set_box(int node, const AABB &box) {
+    (nodes[node].object < 0 ? inner_area : leaf_area) += box.surface_area() - nodes[node].box.surface_area();
+    nodes[node].box = box;
+}
+
+void BVH::build(int threads) {
+    std::vector<BuildPrim> prims;
+    for (int k = 0; k < (int)objects.size(); k++) {
+        if (!objects[k]) continue;
+        BuildPrim prim;
+        prim.box = object_box(k);
+        prim.centroid = prim.box.center();
+        prim.object = k;
+        prims.push_back(prim);
+    }
+
+    int n = static_cast<int>(prims.size());
+    nodes.assign(n > 0 ? 2 * n - 1 : 0, Node());
+    free_nodes.clear();
+    n_built_nodes = 0;
+    root = n > 0 ? build_range(prims, 0, n, -1, threads) : -1;
+
+    inner_area = leaf_area = 0.0;
+    for (const Node &node : nodes) {
+        (node.object < 0 ? inner_area : leaf_area) += node.box.surface_area();
+    }
+    built_quality = quality();
+}
+
+int BVH::build_range(std::vector<BuildPrim> &prims, int begin, int end, int parent, int threads) {
+    int node = n_built_nodes++;
+    nodes[node].parent = parent;
+
+    if (end - begin == 1) {
+        nodes[node].box = prims[begin].box;
+        nodes[node].object = prims[begin].object;
+        nodes[node].left = nodes[node].right = -1;
+        leaf_of[prims[begin].object] = node;
+        return node;
+    }
+    nodes[node].object = -1;
+
+    // bounds of the centroids, in parallel near the root
+    const int n_chunks = end - begin > 65536 ? threads : 1;
+    std::vector<AABB> chunk_centroids(n_chunks, AABB::empty());
+    parallel_for(n_chunks, n_chunks, [&](int c0, int c1) {
+        for (int c = c0; c < c1; c++) {
+            int lo = begin + (long long)(end - begin) * c / n_chunks;
+            int hi = begin + (long long)(end - begin) * (c + 1) / n_chunks;
+            for (int k = lo; k < hi; k++) {
+                chunk_centroids[c] = surrounding_box(chunk_centroids[c], AABB(prims[k].centroid, prims[k].centroid));
+            }
+        }
+    });
+    AABB centroids = AABB::empty();
+    for (int c = 0; c < n_chunks; c++) centroids = surrounding_box(centroids, chunk_centroids[c]);
+
+    // split along the axis with the largest centroid extent
+    Vec3 extent = centroids.extent();
+    int axis = extent.x() > extent.y() ? 0 : 1;
+    if (extent.z() > extent[axis]) axis = 2;
+
+    int mid = begin + (end - begin) / 2;
+    if (extent[axis] > 0.0) {
+        // count the centroids per bin, then sweep for the split with the lowest SAH cost
+        const int n_bins = 12;
+        double scale = n_bins / extent[axis];
+        double origin = centroids.min()[axis];
+        auto bin_of = [&](const BuildPrim &p) {
+            return std::min(n_bins - 1, static_cast<int>((p.centroid[axis] - origin) * scale));
+        };
+
+        std::vector<int> counts(n_chunks * n_bins, 0);
+        std::vector<AABB> bin_boxes(n_chunks * n_bins, AABB::empty());
+        parallel_for(n_chunks, n_chunks, [&](int c0, int c1) {
+            for (int c = c0; c < c1; c++) {
+                int lo = begin + (long long)(end - begin) * c / n_chunks;
+                int hi = begin + (long long)(end - begin) * (c + 1) / n_chunks;
+                for (int k = lo; k < hi; k++) {
+                    int b = c * n_bins + bin_of(prims[k]);
+                    counts[b]++;
+                    bin_boxes[b] = surrounding_box(bin_boxes[b], prims[k].box);
+                }
+            }
+        });
+        for (int c = 1; c < n_chunks; c++) {
+            for (int b = 0; b < n_bins; b++) {
+                counts[b] += counts[c * n_bins + b];
+                bin_boxes[b] = surrounding_box(bin_boxes[b], bin_boxes[c * n_bins + b]);
+            }
+        }
+
+        // the bins cover every box of the range
+        AABB box = AABB::empty();
+        for (int b = 0; b < n_bins; b++) box = surrounding_box(box, bin_boxes[b]);
+        nodes[node].box = box;
+
+        // right_cost[b] covers the bins b+1 .. n_bins-1
+        double right_cost[n_bins];
+        AABB acc = AABB::empty();
+        int acc_count = 0;
+        for (int b = n_bins - 1; b > 0; b--) {
+            acc = surrounding_box(acc, bin_boxes[b]);
+            acc_count += counts[b];
+            right_cost[b - 1] = acc_count > 0 ? acc_count * acc.surface_area() : 0.0;
+        }
+
+        int best_split = -1;
+        double best_cost = infinity;
+        acc = AABB::empty();
+        acc_count = 0;
+        int right_count = end - begin;
+        for (int b = 0; b < n_bins - 1; b++) {
+            acc = surrounding_box(acc, bin_boxes[b]);
+            acc_count += counts[b];
+            right_count -= counts[b];
+            if (acc_count == 0 || right_count == 0) continue;
+            double cost = acc_count * acc.surface_area() + right_cost[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        if (best_split >= 0) {
+            mid = static_cast<int>(std::partition(
+                prims.begin() + begin, prims.begin() + end,
+                [&](const BuildPrim &p) { return bin_of(p) <= best_split; }
+            ) - prims.begin());
+        }
+    } else {
+        // all centroids coincide, split in the middle
+        AABB box = AABB::empty();
+        for (int k = begin; k < end; k++) box = surrounding_box(box, prims[k].box);
+        nodes[node].box = box;
+    }
+
+    // build the children as separate tasks while there are threads to spare
+    if (threads > 1 && end - begin > 4096) {
+        int left_threads = threads / 2;
+        std::thread left_task([&, left_threads]() {
+            nodes[node].left = build_range(prims, begin, mid, node, left_threads);
+        });
+        nodes[node].right = build_range(prims, mid, end, node, threads - left_threads);
+        left_task.join();
+    } else {
+        nodes[node].left = build_range(prims, begin, mid, node, 1);
+        nodes[node].right = build_range(prims, mid, end, node, 1);
+    }
+
+    return node;
+}
+
+int BVH::insert(shared_ptr<HitTable> object) {
+    int handle;
+    if (!free_handles.empty()) {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        objects[handle] = object;
+    } else {
+        handle = static_cast<int>(objects.size());
+        objects.push_back(object);
+        leaf_of.push_back(-1);
+    }
+    n_objects++;
+
+    int leaf = alloc_node();
+    nodes[leaf].object = handle;
+    nodes[leaf].left = nodes[leaf].right = -1;
+    nodes[leaf].box = AABB();
+    set_box(leaf, object_box(handle));
+    leaf_of[handle] = leaf;
+
+    if (root < 0) {
+        nodes[leaf].parent = -1;
+        root = leaf;
+        return handle;
+    }
+
+    // walk down to the sibling that increases the SAH cost the least
+    AABB leaf_box = nodes[leaf].box;
+    int sibling = root;
+    while (nodes[sibling].object < 0) {
+        const Node &n = nodes[sibling];
+        double area = n.box.surface_area();
+        double combined_area = surrounding_box(n.box, leaf_box).surface_area();
+
+        // pairing with this node creates a parent with the combined area,
+        // descending instead makes this node grow by the difference
+        double cost_here = combined_area;
+        double inherited = combined_area - area;
+
+        double child_cost[2];
+        int children[2] = {n.left, n.right};
+        for (int c = 0; c < 2; c++) {
+            const Node &child = nodes[children[c]];
+            double grown = surrounding_box(child.box, leaf_box).surface_area();
+            // a leaf child would be paired, an inner child only grows
+            child_cost[c] = (child.object >= 0 ? grown : grown - child.box.surface_area()) + inherited;
+        }
+
+        if (cost_here <= child_cost[0] && cost_here <= child_cost[1]) break;
+        sibling = child_cost[0] <= child_cost[1] ? n.left : n.right;
+    }
+
+    // pair the leaf with the sibling under a new parent
+    int old_parent = nodes[sibling].parent;
+    int parent = alloc_node();
+    nodes[parent].object = -1;
+    nodes[parent].parent = old_parent;
+    nodes[parent].left = sibling;
+    nodes[parent].right = leaf;
+    nodes[parent].box = AABB();
+    set_box(parent, surrounding_box(nodes[sibling].box, leaf_box));
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+
+    if (old_parent < 0) {
+        root = parent;
+    } else if (nodes[old_parent].left == sibling) {
+        nodes[old_parent].left = parent;
+    } else {
+        nodes[old_parent].right = parent;
+    }
+
+    refit_up(old_parent);
+    return handle;
+}
+
+bool BVH::is_live(int handle) const {
+    return handle >= 0 && handle < static_cast<int>(leaf_of.size()) && leaf_of[handle] >= 0;
+}
+
+void BVH::remove(int handle) {
+    if (!is_live(handle)) return;
+    int leaf = leaf_of[handle];
+    int parent = nodes[leaf].parent;
+
+    if (parent < 0) {
+        root = -1;
+    } else {
+        // the sibling takes the place of the parent
+        int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        int grandparent = nodes[parent].parent;
+        nodes[sibling].parent = grandparent;
+        if (grandparent < 0) {
+            root = sibling;
+        } else if (nodes[grandparent].left == parent) {
+            nodes[grandparent].left = sibling;
+        } else {
+            nodes[grandparent].right = sibling;
+        }
+        free_node(parent);
+        refit_up(grandparent);
+    }
+
+    free_node(leaf);
+    objects[handle] = nullptr;
+    leaf_of[handle] = -1;
+    free_handles.push_back(handle);
+    n_objects--;
+}
+
+void BVH::update(int handle) {
+    if (!is_live(handle)) return;
+    int leaf = leaf_of[handle];
+    set_box(leaf, object_box(handle));
+    refit_up(nodes[leaf].parent);
+}
+
+void BVH::refit_up(int node) {
+    while (node >= 0) {
+        AABB box = surrounding_box(nodes[nodes[node].left].box, nodes[nodes[node].right].box);
+        // the boxes above only depend on this one
+        if (box == nodes[node].box) break;
+        set_box(node, box);
+        node = nodes[node].parent;
+    }
+}
+
+void BVH::refit() {
+    if (root >= 0) refit_node(root);
+}
+
+AABB BVH::refit_node(int node) {
+    if (nodes[node].object >= 0) {
+        set_box(node, object_box(nodes[node].object));
+    } else {
+        AABB left = refit_node(nodes[node].left);
+        AABB right = refit_node(nodes[node].right);
+        set_box(node, surrounding_box(left, right));
+    }
+    return nodes[node].box;
+}
+
+double BVH::quality() const {
+    if (root < 0 || nodes[root].object >= 0) return 0.0;
+    return leaf_area > 0.0 ? (inner_area - nodes[root].box.surface_area()) / leaf_area : 0.0;
+}
+
+double BVH::degradation() const {
+    return built_quality > 0.0 ? quality() / built_quality : 1.0;
+}
+
+bool BVH::rebuild_if_degraded(double max_degradation, int threads) {
+    if (degradation() <= max_degradation) return false;
+    build(threads);
+    return true;
+}
+
+bool BVH::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const {
+    if (root < 0) return false;
+    Vec3 d = r.direction();
+    Vec3 inv_d(1.0 / d.x(), 1.0 / d.y(), 1.0 / d.z());
+    double t_enter = t_min, t_exit = t_max;
+    if (!nodes[root].box.clip(r.orig, inv_d, t_enter, t_exit)) return false;
+    return hit_node(root, r, inv_d, t_min, t_max, rec);
+}
+
+// the box of the node is already known to be hit, t_max shrinks to the closest hit so far
+bool BVH::hit_node(int node, const Ray &r, const Vec3 &inv_d, double t_min, double &t_max, hit_record &rec) const {
+    const Node &n = nodes[node];
+    if (n.object >= 0) {
+        if (!objects[n.object]->hit(r, t_min, t_max, rec)) return false;
+        t_max = rec.t;
+        return true;
+    }
+
+    // visit the child the ray enters first, and the other one only if it starts before the closest hit
+    int near = n.left, far = n.right;
+    double t_near = t_min, t_far = t_min, exit_near = t_max, exit_far = t_max;
+    bool hit_near = nodes[near].box.clip(r.orig, inv_d, t_near, exit_near);
+    bool hit_far = nodes[far].box.clip(r.orig, inv_d, t_far, exit_far);
+    if (hit_far && (!hit_near || t_far < t_near)) {
+        std::swap(near, far);
+        std::swap(t_near, t_far);
+        std::swap(hit_near, hit_far);
+    }
+
+    bool hit = hit_near && hit_node(near, r, inv_d, t_min, t_max, rec);
+    if (hit_far && t_far <= t_max) hit = hit_node(far, r, inv_d, t_min, t_max, rec) || hit;
+    return hit;
+}
+
+bool BVH::bounding_box(AABB &output_box) const {
+    if (root < 0) return false;
+    output_box = nodes[root].box;
+    return true;
+}
+
+#endif
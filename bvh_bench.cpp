@@ -0,0 +1,113 @@
+// time the BVH build against the number of threads, then animate a scene with
+// incremental updates and rebuild when the tree degrades
+// usage: ./bvh_bench [max threads]
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "common.hpp"
+#include "bvh.hpp"
+#include "grid.hpp"
+#include "bench.hpp"
+
+void build_scaling(int n, int max_threads, shared_ptr<Material> mat) {
+    HitTableList world = uniform_scene(n, mat);
+    std::cout << "build, " << n << " spheres\n";
+
+    double base = 0.0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        RenderClock::time_point start = RenderClock::now();
+        BVH bvh(world.objects, threads);
+        double ms = seconds_since(start) * 1e3;
+        if (threads == 1) base = ms;
+        std::cout << "  " << threads << " threads: " << ms << " ms (" << base / ms << "x)\n";
+    }
+}
+
+void trace_rates(int n, int max_threads, shared_ptr<Material> mat) {
+    const char *names[2] = {"uniform", "clustered"};
+    for (int s = 0; s < 2; s++) {
+        HitTableList world = s == 0 ? uniform_scene(n, mat) : clustered_scene(n, mat);
+        std::vector<Ray> rays = primary_rays(20000, n);
+        BVH bvh(world.objects, max_threads);
+        UniformGrid grid(world.objects, max_threads);
+        double grid_sum, bvh_sum;
+        double grid_rate = trace(grid, rays, grid_sum);
+        double bvh_rate = trace(bvh, rays, bvh_sum);
+        std::cout << "trace, " << names[s] << ", " << n << " spheres\n"
+                  << "  grid: " << grid_rate / 1e6 << " Mrays/s\n"
+                  << "  bvh:  " << bvh_rate / 1e6 << " Mrays/s, quality " << bvh.quality()
+                  << (fabs(grid_sum - bvh_sum) > 1e-6 * fabs(grid_sum) ? ", MISMATCH" : "") << '\n';
+    }
+}
+
+// each frame moves some spheres, adds a few and removes a few
+void animate(int n, int frames, int max_threads, shared_ptr<Material> mat) {
+    HitTableList world = uniform_scene(n, mat);
+    BVH bvh(world.objects, max_threads);
+    std::vector<int> handles;
+    for (int k = 0; k < static_cast<int>(world.objects.size()); k++) handles.push_back(k);
+    std::vector<Ray> rays = primary_rays(5000, n);
+    double half = 0.5 * sqrt(double(n));
+
+    RenderClock::time_point start = RenderClock::now();
+    BVH fresh(world.objects, max_threads);
+    double rebuild_ms = seconds_since(start) * 1e3;
+    std::cout << "animate, " << n << " spheres, full rebuild " << rebuild_ms << " ms\n";
+
+    int rebuilds = 0;
+    double sum;
+    for (int frame = 1; frame <= frames; frame++) {
+        start = RenderClock::now();
+
+        // skip the ground sphere at handle 0 and the hollow one at handle 1
+        for (int k = 0; k < n / 100; k++) {
+            int h = handles[2 + static_cast<int>(rand_double() * (handles.size() - 2))];
+            Sphere &sphere = static_cast<Sphere &>(*bvh.objects[h]);
+            sphere.center += Vec3(rand_double(-2, 2), 0, rand_double(-2, 2));
+            bvh.update(h);
+        }
+        for (int k = 0; k < n / 1000; k++) {
+            int idx = 2 + static_cast<int>(rand_double() * (handles.size() - 2));
+            bvh.remove(handles[idx]);
+            handles[idx] = handles.back();
+            handles.pop_back();
+
+            Point3 center(rand_double(-half, half), 0.2, rand_double(-half, half));
+            handles.push_back(bvh.insert(make_shared<Sphere>(center, 0.2, mat)));
+        }
+        double update_ms = seconds_since(start) * 1e3;
+        double degradation = bvh.degradation();
+        bool rebuilt = bvh.rebuild_if_degraded(bvh_max_degradation, max_threads);
+        rebuilds += rebuilt;
+
+        if (frame % 10 == 0 || rebuilt) {
+            std::cout << "  frame " << frame << ": updates " << update_ms << " ms, degradation " << degradation
+                      << (rebuilt ? ", rebuilt" : "") << ", " << trace(bvh, rays, sum) / 1e6 << " Mrays/s\n";
+        }
+    }
+
+    // the tree must still agree with a plain list of the same objects
+    HitTableList current;
+    for (int h : handles) current.add(bvh.objects[h]);
+    double list_sum, bvh_sum;
+    trace(current, rays, list_sum);
+    trace(bvh, rays, bvh_sum);
+    bool same = fabs(list_sum - bvh_sum) <= 1e-6 * fabs(list_sum);
+    std::cout << "  " << rebuilds << " rebuilds in " << frames << " frames, "
+              << (same ? "hits match the list" : "MISMATCH with the list") << '\n';
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 4;
+    seed_random(1);
+    std::cout << std::setprecision(4);
+
+    shared_ptr<Material> mat = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    build_scaling(100000, max_threads, mat);
+    build_scaling(1000000, max_threads, mat);
+    trace_rates(50000, max_threads, mat);
+    animate(100000, 50, max_threads, mat);
+    return 0;
+}
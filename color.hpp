@@ -4,19 +4,30 @@
 #include "vec3.hpp"
 #include <iostream>
 
-void write_color(std::ostream &out, Color pixel_color, int samples_per_pixel=1) {
-    Color copied_pixel_color = Color(pixel_color);
+// gamma-correct (gamma 2) a color component and translate it to [0, 255]
+inline int color_byte(double c) {
+    return static_cast<int>(256 * clamp(sqrt(c), 0.0, 0.999));
+}
 
+void write_color(std::ostream &out, Color pixel_color, int samples_per_pixel=1) {
     // divide the color by the number of samples
-    copied_pixel_color /= double(samples_per_pixel);
-    double r = sqrt(copied_pixel_color.x());
-    double g = sqrt(copied_pixel_color.y());
-    double b = sqrt(copied_pixel_color.z());
+    Color c = pixel_color / double(samples_per_pixel);
 
     // write the translated [0, 255] value of each color component
-    out << static_cast<int>(256 * clamp(r, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(g, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
+    out << color_byte(c.x()) << ' '
+        << color_byte(c.y()) << ' '
+        << color_byte(c.z()) << '\n';
+}
+
+// same as write_color, for binary (P6) ppm images
+void write_color_binary(std::ostream &out, Color pixel_color, int samples_per_pixel=1) {
+    Color c = pixel_color / double(samples_per_pixel);
+    char rgb[3] = {
+        static_cast<char>(color_byte(c.x())),
+        static_cast<char>(color_byte(c.y())),
+        static_cast<char>(color_byte(c.z()))
+    };
+    out.write(rgb, 3);
 }
 
 #endif
@@ -20,11 +20,26 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// every thread owns a generator, so threads can sample without locking
+inline std::mt19937 &rand_generator() {
+    static thread_local std::mt19937 generator;
+    return generator;
+}
+
+// reseed the generator of the calling thread
+inline void seed_random(std::seed_seq &seq) {
+    rand_generator().seed(seq);
+}
+
+inline void seed_random(unsigned int seed) {
+    std::seed_seq seq{seed};
+    seed_random(seq);
+}
+
 // return a random real in [0, 1)
 inline double rand_double() {
-    static std::uniform_real_distribution<double> dist(0.0, 1.0);
-    static std::mt19937 generator;
-    return dist(generator);
+    static thread_local std::uniform_real_distribution<double> dist(0.0, 1.0);
+    return dist(rand_generator());
 }
 
 // return a random real in [min, max)
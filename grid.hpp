@@ -0,0 +1,253 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "common.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// uniform grid over the objects of a scene, traversed with a 3D-DDA
+// objects much larger than the typical one (like the ground sphere) and objects without
+// a bounding box are kept out of the grid in a list that every ray tests
+class UniformGrid : public HitTable {
+    public:
+        // cells_per_object: how many cells to create per object in the grid
+        // oversize: objects whose box diagonal is larger than this times the median go to the list
+        UniformGrid(
+            const std::vector<shared_ptr<HitTable>> &scene_objects, int threads = 1,
+            double cells_per_object = 2.0, double oversize = 8.0
+        );
+
+        virtual bool hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+        virtual bool bounding_box(AABB &output_box) const override;
+
+        int n_cells() const { return res[0] * res[1] * res[2]; }
+
+    private:
+        int cell_index(int x, int y, int z) const { return (z * res[1] + y) * res[0] + x; }
+        int cell_coord(double p, int axis) const;
+
+    public:
+        // objects tested by every ray
+        HitTableList large;
+        // objects in the grid, cell c holds cell_objects[cell_start[c] .. cell_start[c+1]]
+        std::vector<shared_ptr<HitTable>> objects;
+        std::vector<int> cell_start;
+        std::vector<int> cell_objects;
+
+        AABB bounds;
+        int res[3];
+        Vec3 cell_size;
+        Vec3 inv_cell_size;
+};
+
+UniformGrid::UniformGrid(
+    const std::vector<shared_ptr<HitTable>> &scene_objects, int threads,
+    double cells_per_object, double oversize
+) {
+    int n = static_cast<int>(scene_objects.size());
+
+    // boxes and their sizes
+    std::vector<AABB> boxes(n);
+    std::vector<double> diagonals(n);
+    std::vector<char> has_box(n);
+    parallel_for(n, threads, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            has_box[k] = scene_objects[k]->bounding_box(boxes[k]);
+            diagonals[k] = has_box[k] ? boxes[k].extent().length() : 0.0;
+        }
+    });
+
+    // the median size of the objects that have a box
+    std::vector<double> sorted;
+    for (int k = 0; k < n; k++) {
+        if (has_box[k]) sorted.push_back(diagonals[k]);
+    }
+    double median = 0.0;
+    if (!sorted.empty()) {
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        median = sorted[sorted.size() / 2];
+    }
+
+    // split off the oversized objects and the ones without a box
+    std::vector<AABB> grid_boxes;
+    for (int k = 0; k < n; k++) {
+        if (!has_box[k] || diagonals[k] > oversize * median) {
+            large.add(scene_objects[k]);
+        } else {
+            objects.push_back(scene_objects[k]);
+            grid_boxes.push_back(boxes[k]);
+        }
+    }
+    int m = static_cast<int>(objects.size());
+
+    res[0] = res[1] = res[2] = 1;
+    if (m == 0) {
+        cell_start.assign(2, 0);
+        return;
+    }
+
+    bounds = grid_boxes[0];
+    for (const AABB &box : grid_boxes) bounds = surrounding_box(bounds, box);
+
+    // about cells_per_object * m cells, as close to cubes as possible over the axes that
+    // are thick enough for one, the others (like the height of a flat scene) get a single cell
+    Vec3 extent = bounds.extent();
+    double max_extent = fmax(extent.x(), fmax(extent.y(), extent.z()));
+    double eps = 1e-6 * fmax(max_extent, 1.0);
+    bool flat[3];
+    for (int a = 0; a < 3; a++) flat[a] = !(extent[a] > 0.0);
+    double cells_per_unit = 0.0;
+    for (int pass = 0; pass < 3; pass++) {
+        double size = 1.0;
+        int dims = 0;
+        for (int a = 0; a < 3; a++) {
+            if (!flat[a]) {
+                size *= extent[a];
+                dims++;
+            }
+        }
+        if (dims == 0) break;
+        cells_per_unit = pow(cells_per_object * m / size, 1.0 / dims);
+
+        // axes that would get a single cell anyway are dropped, which makes the cells smaller
+        // along the others, so this settles
+        bool changed = false;
+        for (int a = 0; a < 3; a++) {
+            if (!flat[a] && extent[a] * cells_per_unit < 2.0) flat[a] = changed = true;
+        }
+        if (!changed) break;
+    }
+    for (int a = 0; a < 3; a++) {
+        res[a] = flat[a] ? 1 : std::max(1, static_cast<int>(extent[a] * cells_per_unit));
+        // pad the box so that points on the far side still fall into the last cell
+        bounds.maximum[a] += eps;
+        bounds.minimum[a] -= eps;
+        cell_size[a] = (bounds.maximum[a] - bounds.minimum[a]) / res[a];
+        inv_cell_size[a] = 1.0 / cell_size[a];
+    }
+
+    // count the objects per cell, then place them, both in parallel over the objects
+    int cells = n_cells();
+    std::vector<std::atomic<int>> counts(cells);
+    for (std::atomic<int> &c : counts) c = 0;
+
+    auto for_each_cell = [&](const AABB &box, int k, bool place) {
+        int lo[3], hi[3];
+        for (int a = 0; a < 3; a++) {
+            lo[a] = cell_coord(box.min()[a], a);
+            hi[a] = cell_coord(box.max()[a], a);
+        }
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++) {
+                    int c = cell_index(x, y, z);
+                    int slot = counts[c]++;
+                    if (place) cell_objects[slot] = k;
+                }
+    };
+
+    parallel_for(m, threads, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) for_each_cell(grid_boxes[k], k, false);
+    });
+
+    cell_start.assign(cells + 1, 0);
+    for (int c = 0; c < cells; c++) {
+        cell_start[c + 1] = cell_start[c] + counts[c];
+        // from now on, counts[c] is the next free slot of the cell
+        counts[c] = cell_start[c];
+    }
+    cell_objects.assign(cell_start[cells], 0);
+
+    parallel_for(m, threads, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) for_each_cell(grid_boxes[k], k, true);
+    });
+
+    // the threads placed the objects in any order, restore the scene order
+    parallel_for(cells, threads, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            std::sort(cell_objects.begin() + cell_start[c], cell_objects.begin() + cell_start[c + 1]);
+        }
+    });
+}
+
+int UniformGrid::cell_coord(double p, int axis) const {
+    int c = static_cast<int>((p - bounds.min()[axis]) * inv_cell_size[axis]);
+    return std::max(0, std::min(c, res[axis] - 1));
+}
+
+bool UniformGrid::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const {
+    // the large objects first, they often give a close hit that shortens the walk
+    bool hit_any = large.hit(r, t_min, t_max, rec);
+    double closest_t = hit_any ? rec.t : t_max;
+
+    double t_enter = t_min;
+    double t_exit = closest_t;
+    if (objects.empty() || !bounds.clip(r, t_enter, t_exit)) return hit_any;
+
+    // set up the walk from the cell where the ray enters the grid
+    Point3 p = r.at(t_enter);
+    int cell[3], step[3], out[3];
+    double t_next[3], t_delta[3];
+    for (int a = 0; a < 3; a++) {
+        double d = r.direction()[a];
+        cell[a] = cell_coord(p[a], a);
+        if (d > 0.0) {
+            step[a] = 1;
+            out[a] = res[a];
+            t_next[a] = t_enter + (bounds.min()[a] + (cell[a] + 1) * cell_size[a] - p[a]) / d;
+            t_delta[a] = cell_size[a] / d;
+        } else if (d < 0.0) {
+            step[a] = -1;
+            out[a] = -1;
+            t_next[a] = t_enter + (bounds.min()[a] + cell[a] * cell_size[a] - p[a]) / d;
+            t_delta[a] = -cell_size[a] / d;
+        } else {
+            step[a] = 0;
+            out[a] = -1;
+            t_next[a] = infinity;
+            t_delta[a] = infinity;
+        }
+    }
+
+    hit_record temp_rec;
+    while (true) {
+        int c = cell_index(cell[0], cell[1], cell[2]);
+        for (int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+            if (objects[cell_objects[k]]->hit(r, t_min, closest_t, temp_rec)) {
+                hit_any = true;
+                closest_t = temp_rec.t;
+                rec = temp_rec;
+            }
+        }
+
+        // step across the nearest cell boundary
+        int a = t_next[0] < t_next[1] ? 0 : 1;
+        if (t_next[2] < t_next[a]) a = 2;
+
+        // nothing in the following cells can be closer than a hit inside this one
+        if (closest_t <= t_next[a] || t_next[a] > t_exit) break;
+        cell[a] += step[a];
+        if (cell[a] == out[a]) break;
+        t_next[a] += t_delta[a];
+    }
+
+    return hit_any;
+}
+
+bool UniformGrid::bounding_box(AABB &output_box) const {
+    AABB large_box;
+    if (!large.objects.empty() && !large.bounding_box(large_box)) return false;
+    if (objects.empty() && large.objects.empty()) return false;
+
+    if (objects.empty()) output_box = large_box;
+    else if (large.objects.empty()) output_box = bounds;
+    else output_box = surrounding_box(bounds, large_box);
+    return true;
+}
+
+#endif
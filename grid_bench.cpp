@@ -0,0 +1,44 @@
+// compare the uniform grid with the linear list on uniform and clustered sphere scenes
+// usage: ./grid_bench [max threads]
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "common.hpp"
+#include "grid.hpp"
+#include "bench.hpp"
+
+void bench(const std::string &name, const HitTableList &world, int max_threads) {
+    std::vector<Ray> rays = primary_rays(20000, world.objects.size());
+
+    std::cout << name << ", " << world.objects.size() << " spheres\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        RenderClock::time_point start = RenderClock::now();
+        UniformGrid grid(world.objects, threads);
+        std::cout << "  grid build, " << threads << " threads: " << seconds_since(start) * 1e3 << " ms\n";
+    }
+
+    UniformGrid grid(world.objects, max_threads);
+    double list_sum, grid_sum;
+    double list_rate = trace(world, rays, list_sum);
+    double grid_rate = trace(grid, rays, grid_sum);
+    std::cout << "  grid: " << grid.res[0] << 'x' << grid.res[1] << 'x' << grid.res[2] << " cells, "
+              << grid.large.objects.size() << " large objects\n"
+              << "  list: " << list_rate / 1e6 << " Mrays/s\n"
+              << "  grid: " << grid_rate / 1e6 << " Mrays/s (" << grid_rate / list_rate << "x)"
+              << (fabs(list_sum - grid_sum) > 1e-6 * fabs(list_sum) ? ", MISMATCH" : "") << '\n';
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 4;
+    seed_random(1);
+
+    shared_ptr<Material> mat = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    for (int n = 500; n <= 50000; n *= 10) {
+        std::cout << std::setprecision(4);
+        bench("uniform", uniform_scene(n, mat), max_threads);
+        bench("clustered", clustered_scene(n, mat), max_threads);
+    }
+    return 0;
+}
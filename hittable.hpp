@@ -2,6 +2,7 @@
 #define HITTABLE_H
 
 #include "ray.hpp"
+#include "aabb.hpp"
 
 class Material;
 
@@ -21,6 +22,8 @@ struct hit_record {
 class HitTable {
     public:
         virtual bool hit(const Ray &r, double t_min, double t_max, hit_record &rec) const = 0;
+        // return false if the object has no bounding box (e.g. an infinite plane)
+        virtual bool bounding_box(AABB &output_box) const = 0;
 };
 
 #endif
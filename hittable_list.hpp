@@ -21,6 +21,7 @@ class HitTableList : public HitTable {
         void add(shared_ptr<HitTable> object) { objects.push_back(object); }
 
         virtual bool hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+        virtual bool bounding_box(AABB &output_box) const override;
 };
 
 bool HitTableList::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const {
@@ -39,4 +40,18 @@ bool HitTableList::hit(const Ray &r, double t_min, double t_max, hit_record &rec
     return hit_any;
 }
 
+bool HitTableList::bounding_box(AABB &output_box) const {
+    if (objects.empty()) return false;
+
+    AABB temp_box;
+    bool first_box = true;
+    for (const shared_ptr<HitTable> &object : objects) {
+        if (!object->bounding_box(temp_box)) return false;
+        output_box = first_box ? temp_box : surrounding_box(output_box, temp_box);
+        first_box = false;
+    }
+
+    return true;
+}
+
 #endif
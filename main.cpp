@@ -1,4 +1,5 @@
-// generate the ppm image content, output as plain text
+// render a scene and output the image, see ./main --help for the options
+#include <fstream>
 #include <iostream>
 
 #include "common.hpp"
@@ -7,121 +8,101 @@
 #include "hittable_list.hpp"
 #include "camera.hpp"
 #include "material.hpp"
-
-Color ray_color(const Ray &r, const HitTableList &world, int remaining_depth) {
-    hit_record rec;
-    // if there is no remaining depth, no more light is gathered
-    // Color(0, 0, 0) is black
-    if (remaining_depth <= 0) {
-        return Color(0, 0, 0);
+#include "render.hpp"
+#include "scene.hpp"
+#include "denoise.hpp"
+#include "options.hpp"
+
+int main(int argc, char **argv) {
+    // the time limit covers the whole run
+    RenderClock::time_point run_start = RenderClock::now();
+
+    // options
+    Options opt;
+    std::string error;
+    if (!parse_options(argc, argv, opt, error)) {
+        std::cerr << error << '\n';
+        print_usage(std::cerr, argv[0]);
+        return 1;
     }
-
-    // if the ray hits any object in the world
-    if (world.hit(r, 0.0001, infinity, rec)) {
-        // // generate reflection (scattered) rays
-        Ray scattered;
-        Color attenuation;
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
-            return attenuation * ray_color(scattered, world, remaining_depth-1);
-        } else {
-            // black
-            return Color(0, 0, 0);
-        }
+    if (opt.help) {
+        print_usage(std::cout, argv[0]);
+        return 0;
     }
+    seed_random(opt.render.seed);
 
-    // background (the ray does not hit the sphere)
-    Vec3 unit_direction = unit_vector(r.direction());
-    // t in the range (0, 1), increases as y increases
-    double t = 0.5 * (unit_direction.y() + 1.0);
-    // interpolate white (t=0) and sky blue (t=1)
-    return (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
-}
-
-HitTableList random_scene() {
-    HitTableList world;
-
-    shared_ptr<Material> ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            double material_selector = rand_double();
-            Point3 center(a + 0.9*rand_double(), 0.2, b + 0.9*rand_double());
-
-            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<Material> sphere_material;
-
-                // set the material ptr
-                if (material_selector < 0.8) {
-                    // diffuse material
-                    Color albedo = Color::random() * Color::random();
-                    sphere_material = make_shared<Lambertian>(albedo);
-                } else if (material_selector < 0.95) {
-                    // metal
-                    Color albedo = Color::random(0.5, 1);
-                    double fuzz = rand_double(0, 0.5);
-                    sphere_material = make_shared<Metal>(albedo, fuzz);
-                } else {
-                    // dielectric
-                    sphere_material = make_shared<Dielectric>(1.5);
-                }
-
-                // add to scene
-                world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-            }
-        }
+    // world
+    Scene scene;
+    if (!make_scene(opt.scene, scene, error)) {
+        std::cerr << error << '\n';
+        return 1;
     }
 
-    shared_ptr<Material> material1 = make_shared<Dielectric>(1.5);
-    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
-
-    shared_ptr<Material> material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
-
-    shared_ptr<Material> material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
+    // camera, the command line overrides the scene
+    for (const std::pair<std::string, std::string> &param : opt.camera_params) {
+        set_camera_param(scene.camera, param.first, param.second);
+    }
+    Camera camera = scene.camera.make_camera(opt.aspect_ratio);
+
+    // keep time for the work after rendering
+    int n_pixels = opt.image_width * opt.image_height;
+    int n_images = 1 + (opt.sample_map.empty() ? 0 : 1) + (opt.aov_prefix.empty() ? 0 : 3);
+    opt.render.deadline = seconds_after(run_start, opt.render.time_limit);
+    opt.render.reserve_seconds = n_images * output_seconds(n_pixels);
+    if (opt.denoise) opt.render.reserve_seconds += denoise_seconds(n_pixels, opt.denoise_settings, opt.render.threads);
+
+    // acceleration structure
+    RenderClock::time_point build_start = RenderClock::now();
+    shared_ptr<HitTable> world = build_accel(opt.accel, scene.world, opt.render.threads);
+    std::cerr << "Built the acceleration structure in " << seconds_since(build_start) << " s\n";
+
+    // render
+    Film film(opt.image_width, opt.image_height);
+    if (opt.denoise || !opt.aov_prefix.empty()) film.enable_aovs();
+    RenderStats stats = render(camera, *world, film, opt.render);
+    print_stats(std::cerr, stats);
+
+    // post-process
+    std::vector<Color> image;
+    if (opt.denoise) {
+        RenderClock::time_point denoise_start = RenderClock::now();
+        image = denoise(film, opt.denoise_settings, opt.render.threads);
+        std::cerr << "Denoised in " << seconds_since(denoise_start) << " s\n";
+    } else {
+        image = film.resolve();
+    }
 
-int main() {
     // image
-    const double aspect_ratio = 3.0 / 2.0;
-    const int image_width = 1200;
-    const int image_height = static_cast<int>(image_width / aspect_ratio);
-    const int samples_per_pixel = 500;
-    const int max_reflection_depth = 50;
-
-    // world
-    HitTableList world = random_scene();
-
-    // camera
-    Point3 look_from(13, 2, 3);
-    Point3 look_at(0, 0, 0);
-    Vec3 vup(0, 1, 0);
-    double aperture = 0.1;
-    double focus_dist = 10;
-    Camera camera(look_from, look_at, vup, 20.0, aspect_ratio, aperture, focus_dist);
+    if (opt.output == "-") {
+        write_image(std::cout, film.width, film.height, image, opt.format);
+    } else {
+        std::ofstream out(opt.output.c_str(), std::ios::binary);
+        write_image(out, film.width, film.height, image, opt.format);
+        if (!out) {
+            std::cerr << "cannot write " << opt.output << '\n';
+            return 1;
+        }
+    }
 
-    // ppm header
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+    if (!opt.sample_map.empty()) {
+        std::ofstream out(opt.sample_map.c_str());
+        write_sample_map(out, film);
+        if (!out) {
+            std::cerr << "cannot write " << opt.sample_map << '\n';
+            return 1;
+        }
+    }
 
-    // content
-    // scan from the upper left corner to the lower right corner, line by line
-    for (int i = 0; i < image_height; i++) {
-        std::cerr << "\rScan lines remaining: " << image_height - i - 1 << ' ' << std::flush;
-        for (int j = 0; j < image_width; j++) {
-            Color pixel_color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; s++) {
-                double u = (j + rand_double()) / (image_width - 1);
-                double v = (i + rand_double()) / (image_height - 1);
-                Ray r = camera.get_ray(u, v);
-                pixel_color += ray_color(r, world, max_reflection_depth);
-            }
-            write_color(std::cout, pixel_color, samples_per_pixel);
+    if (!opt.aov_prefix.empty()) {
+        std::ofstream albedo_out((opt.aov_prefix + "_albedo.pfm").c_str(), std::ios::binary);
+        std::ofstream normal_out((opt.aov_prefix + "_normal.pfm").c_str(), std::ios::binary);
+        std::ofstream depth_out((opt.aov_prefix + "_depth.pfm").c_str(), std::ios::binary);
+        write_aovs(albedo_out, normal_out, depth_out, film);
+        if (!albedo_out || !normal_out || !depth_out) {
+            std::cerr << "cannot write the AOVs to " << opt.aov_prefix << "_*.pfm\n";
+            return 1;
         }
     }
-    std::cerr << "\nDone.\n";
 
     return 0;
 }
@@ -10,6 +10,13 @@ class Material {
         virtual bool scatter(
             const Ray &r_in, const hit_record &rec, Color &attenuation, Ray &scattered
         ) const = 0;
+
+        // base color of the surface, used for the albedo AOV
+        virtual Color albedo_color() const = 0;
+
+        // true if the surface shows a sharp image of its surroundings, the AOVs
+        // then describe what is seen through it instead of the surface itself
+        virtual bool is_specular() const { return false; }
 };
 
 class Lambertian : public Material {
@@ -33,6 +40,8 @@ class Lambertian : public Material {
             return true;
         }
 
+        virtual Color albedo_color() const override { return albedo; }
+
     public:
         Color albedo;
 };
@@ -50,6 +59,10 @@ class Metal : public Material {
             return (dot(scattered.direction(), rec.normal) > 0.0);
         }
 
+        virtual Color albedo_color() const override { return albedo; }
+        // slightly fuzzy reflections still count as sharp
+        virtual bool is_specular() const override { return fuzz < 0.1; }
+
     public:
         Color albedo;
         double fuzz;
@@ -84,6 +97,9 @@ class Dielectric : public Material {
             return true;
         }
 
+        virtual Color albedo_color() const override { return albedo; }
+        virtual bool is_specular() const override { return true; }
+
     public:
         Color albedo;
         // refractive index
@@ -0,0 +1,231 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "render.hpp"
+#include "scene.hpp"
+#include "denoise.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// everything that can be set from the command line
+struct Options {
+    int image_width = 1200;
+    // 0 means derived from the width and the aspect ratio
+    int image_height = 0;
+    double aspect_ratio = 3.0 / 2.0;
+
+    RenderSettings render;
+
+    std::string scene = "random";
+    Accel accel = Accel::grid;
+    // camera parameters given on the command line, applied over the ones from the scene
+    std::vector<std::pair<std::string, std::string>> camera_params;
+
+    // "-" is stdout
+    std::string output = "-";
+    ImageFormat format = ImageFormat::ppm;
+    std::string sample_map;
+    // write PREFIX_albedo.pfm, PREFIX_normal.pfm and PREFIX_depth.pfm
+    std::string aov_prefix;
+
+    bool denoise = false;
+    DenoiseSettings denoise_settings;
+
+    bool help = false;
+
+    Options() {
+        render.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+};
+
+void print_usage(std::ostream &out, const char *program) {
+    out << "Usage: " << program << " [options]\n"
+        << "\n"
+        << "Image:\n"
+        << "  -w, --width N          image width in pixels (default 1200)\n"
+        << "  -H, --height N         image height in pixels (default width / aspect)\n"
+        << "  -a, --aspect R         aspect ratio, e.g. 1.5 or 3:2 (default 3:2)\n"
+        << "  -o, --output PATH      output image, - for stdout (default -)\n"
+        << "  -f, --format F         ppm, ppm-binary or pfm (default ppm, or from the extension)\n"
+        << "      --spp-map PATH     also write the per-pixel sample counts as a pgm image\n"
+        << "      --aov PREFIX       also write the albedo, normal and depth of the first hits as\n"
+        << "                         PREFIX_albedo.pfm, PREFIX_normal.pfm and PREFIX_depth.pfm\n"
+        << "      --denoise          filter the image guided by the albedo, normal and depth\n"
+        << "      --denoise-iterations N  number of filter passes (default 5)\n"
+        << "\n"
+        << "Rendering:\n"
+        << "  -s, --spp N            samples per pixel (default 500)\n"
+        << "  -d, --depth N          max reflection depth (default 50)\n"
+        << "  -j, --threads N        number of threads (default: all cores)\n"
+        << "      --seed N           random seed (default 0)\n"
+        << "  -i, --integrator I     path or normal (default path)\n"
+        << "  -t, --time-limit S     wall-clock budget in seconds, chooses spp and depth\n"
+        << "      --noise X          stop sampling pixels below this relative noise, e.g. 0.02\n"
+        << "\n"
+        << "Scene and camera:\n"
+        << "      --scene S          random, or a scene file (default random)\n"
+        << "      --accel A          list, grid or bvh (default grid)\n"
+        << "      --look-from X,Y,Z  camera origin (default 13,2,3)\n"
+        << "      --look-at X,Y,Z    point the camera looks at (default 0,0,0)\n"
+        << "      --vup X,Y,Z        upward direction (default 0,1,0)\n"
+        << "      --vfov DEG         vertical field of view (default 20)\n"
+        << "      --aperture A       lens diameter (default 0.1)\n"
+        << "      --focus-dist D     distance to the focus plane (default 10)\n"
+        << "\n"
+        << "  -h, --help             show this message\n";
+}
+
+bool parse_int(const std::string &s, int &x) {
+    char *end;
+    errno = 0;
+    long v = strtol(s.c_str(), &end, 10);
+    if (s.empty() || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX) return false;
+    x = static_cast<int>(v);
+    return true;
+}
+
+// "1.5" or "3:2"
+bool parse_ratio(const std::string &s, double &x) {
+    std::string::size_type colon = s.find(':');
+    if (colon == std::string::npos) return parse_double(s, x) && x > 0;
+    double num, den;
+    if (!parse_double(s.substr(0, colon), num) || !parse_double(s.substr(colon + 1), den) || den <= 0) {
+        return false;
+    }
+    x = num / den;
+    return x > 0;
+}
+
+// "--look-from" is the camera parameter "look_from"
+std::string camera_key(const std::string &arg) {
+    if (arg.compare(0, 2, "--") != 0) return "";
+    std::string key = arg.substr(2);
+    for (char &c : key) {
+        if (c == '-') c = '_';
+    }
+    return key;
+}
+
+bool parse_format(const std::string &s, ImageFormat &format) {
+    if (s == "ppm") format = ImageFormat::ppm;
+    else if (s == "ppm-binary") format = ImageFormat::ppm_binary;
+    else if (s == "pfm") format = ImageFormat::pfm;
+    else return false;
+    return true;
+}
+
+// on failure, error describes the offending argument
+bool parse_options(int argc, char **argv, Options &opt, std::string &error) {
+    bool format_given = false;
+
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        std::string value;
+        bool has_value = false;
+
+        // accept both "--name value" and "--name=value"
+        std::string::size_type eq = arg.find('=');
+        if (arg.compare(0, 2, "--") == 0 && eq != std::string::npos) {
+            value = arg.substr(eq + 1);
+            arg = arg.substr(0, eq);
+            has_value = true;
+        }
+
+        // flags without a value
+        if (arg == "-h" || arg == "--help") {
+            opt.help = true;
+            continue;
+        }
+        if (arg == "--denoise") {
+            opt.denoise = true;
+            continue;
+        }
+
+        if (!has_value) {
+            if (k + 1 >= argc) {
+                error = "missing value for " + arg;
+                return false;
+            }
+            value = argv[++k];
+        }
+
+        bool ok;
+        if (arg == "-w" || arg == "--width") ok = parse_int(value, opt.image_width) && opt.image_width > 1;
+        else if (arg == "-H" || arg == "--height") ok = parse_int(value, opt.image_height) && opt.image_height > 1;
+        else if (arg == "-a" || arg == "--aspect") ok = parse_ratio(value, opt.aspect_ratio);
+        else if (arg == "-o" || arg == "--output") ok = !(opt.output = value).empty();
+        else if (arg == "-f" || arg == "--format") ok = format_given = parse_format(value, opt.format);
+        else if (arg == "--spp-map") ok = !(opt.sample_map = value).empty();
+        else if (arg == "--aov") ok = !(opt.aov_prefix = value).empty();
+        else if (arg == "--denoise-iterations") {
+            ok = parse_int(value, opt.denoise_settings.iterations) && opt.denoise_settings.iterations >= 0;
+        }
+        else if (arg == "-s" || arg == "--spp") ok = parse_int(value, opt.render.max_samples) && opt.render.max_samples > 0;
+        else if (arg == "-d" || arg == "--depth") ok = parse_int(value, opt.render.max_depth) && opt.render.max_depth > 0;
+        else if (arg == "-j" || arg == "--threads") ok = parse_int(value, opt.render.threads) && opt.render.threads > 0;
+        else if (arg == "--seed") {
+            int seed;
+            ok = parse_int(value, seed);
+            opt.render.seed = static_cast<unsigned int>(seed);
+        }
+        else if (arg == "-i" || arg == "--integrator") {
+            ok = true;
+            if (value == "path") opt.render.integrator = Integrator::path;
+            else if (value == "normal") opt.render.integrator = Integrator::normal;
+            else ok = false;
+        }
+        else if (arg == "-t" || arg == "--time-limit") ok = parse_double(value, opt.render.time_limit);
+        else if (arg == "--noise") ok = parse_double(value, opt.render.target_noise);
+        else if (arg == "--scene") ok = !(opt.scene = value).empty();
+        else if (arg == "--accel") {
+            ok = true;
+            if (value == "list") opt.accel = Accel::list;
+            else if (value == "grid") opt.accel = Accel::grid;
+            else if (value == "bvh") opt.accel = Accel::bvh;
+            else ok = false;
+        }
+        else if (is_camera_param(camera_key(arg))) {
+            // validate now, apply once the scene is loaded
+            CameraSettings probe;
+            ok = set_camera_param(probe, camera_key(arg), value);
+            opt.camera_params.push_back(std::make_pair(camera_key(arg), value));
+        } else {
+            error = "unknown option " + arg;
+            return false;
+        }
+
+        if (!ok) {
+            error = "invalid value for " + arg + ": " + value;
+            return false;
+        }
+    }
+
+    // an explicit format wins over the extension of the output
+    if (!format_given) {
+        std::string::size_type dot = opt.output.rfind('.');
+        if (dot != std::string::npos && opt.output.substr(dot) == ".pfm") opt.format = ImageFormat::pfm;
+    }
+
+    double height = opt.image_height > 0 ? opt.image_height : std::max(2.0, floor(opt.image_width / opt.aspect_ratio));
+    // pixel indices are ints, and the pfm writer indexes three floats per pixel
+    if (double(opt.image_width) * height > INT_MAX / 3) {
+        error = "the image is too large: " + std::to_string(opt.image_width) + " x " + std::to_string(static_cast<long long>(height));
+        return false;
+    }
+    if (opt.image_height > 0) {
+        opt.aspect_ratio = double(opt.image_width) / opt.image_height;
+    } else {
+        opt.image_height = static_cast<int>(height);
+    }
+
+    return true;
+}
+
+#endif
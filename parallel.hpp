@@ -0,0 +1,25 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// split [0, n) into one contiguous chunk per thread and call f(begin, end) on each
+// the calling thread takes the first chunk
+template <typename F>
+void parallel_for(int n, int threads, F f) {
+    int n_threads = std::max(1, std::min(threads, n));
+    int chunk = (n + n_threads - 1) / n_threads;
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < n_threads; t++) {
+        int begin = std::min(n, t * chunk);
+        int end = std::min(n, begin + chunk);
+        workers.emplace_back(f, begin, end);
+    }
+    f(0, std::min(n, chunk));
+    for (std::thread &worker : workers) worker.join();
+}
+
+#endif
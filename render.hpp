@@ -0,0 +1,504 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "common.hpp"
+#include "color.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+#include "camera.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// what a path saw besides its color
+struct PathInfo {
+    // number of surfaces hit along the path
+    int bounces = 0;
+    // first non-specular hit of the path, the albedo is the background if the path
+    // escapes before, and is tinted by the specular surfaces on the way
+    bool aov_done = false;
+    Color albedo;
+    Vec3 normal;
+    // distance along the path to that hit, 0 if there is none
+    double depth = 0.0;
+    Color throughput = Color(1, 1, 1);
+};
+
+Color background_color(const Ray &r) {
+    Vec3 unit_direction = unit_vector(r.direction());
+    // t in the range (0, 1), increases as y increases
+    double t = 0.5 * (unit_direction.y() + 1.0);
+    // interpolate white (t=0) and sky blue (t=1)
+    return (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
+}
+
+// info (if not null) collects the bounces and the first hit of the path
+Color ray_color(const Ray &r, const HitTable &world, int remaining_depth, PathInfo *info = nullptr) {
+    hit_record rec;
+    // if there is no remaining depth, no more light is gathered
+    // Color(0, 0, 0) is black
+    if (remaining_depth <= 0) {
+        return Color(0, 0, 0);
+    }
+
+    // if the ray hits any object in the world
+    if (world.hit(r, 0.0001, infinity, rec)) {
+        if (info) {
+            if (!info->aov_done) {
+                info->depth += rec.t * r.direction().length();
+                // the last bounce has no path left to follow
+                if (!rec.mat_ptr->is_specular() || remaining_depth == 1) {
+                    info->albedo = info->throughput * rec.mat_ptr->albedo_color();
+                    info->normal = rec.normal;
+                    info->aov_done = true;
+                } else {
+                    info->throughput = info->throughput * rec.mat_ptr->albedo_color();
+                }
+            }
+            info->bounces++;
+        }
+        // // generate reflection (scattered) rays
+        Ray scattered;
+        Color attenuation;
+        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
+            return attenuation * ray_color(scattered, world, remaining_depth-1, info);
+        } else {
+            // black
+            return Color(0, 0, 0);
+        }
+    }
+
+    // background (the ray does not hit the sphere)
+    Color background = background_color(r);
+    if (info && !info->aov_done) {
+        info->albedo = info->throughput * background;
+        info->depth = 0.0;
+        info->aov_done = true;
+    }
+    return background;
+}
+
+// visualize the shading normal of the first hit, for debugging scenes
+Color normal_color(const Ray &r, const HitTable &world) {
+    hit_record rec;
+    if (world.hit(r, 0.0001, infinity, rec)) {
+        return 0.5 * (rec.normal + Color(1, 1, 1));
+    }
+    return Color(0, 0, 0);
+}
+
+enum class Integrator { path, normal };
+
+Color integrate(Integrator integrator, const Ray &r, const HitTable &world, int depth, PathInfo *info = nullptr) {
+    switch (integrator) {
+        case Integrator::normal: return normal_color(r, world);
+        default: return ray_color(r, world, depth, info);
+    }
+}
+
+inline double luminance(const Color &c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+// accumulated samples of every pixel, stored line by line from the upper left corner
+struct Film {
+    int width;
+    int height;
+    std::vector<Color> color_sum;
+    // luminance moments, used to estimate the noise of a pixel
+    std::vector<double> lum_sum;
+    std::vector<double> lum_sq_sum;
+    std::vector<int> samples;
+    // auxiliary buffers (AOVs) of the first hits, empty unless enable_aovs() was called
+    std::vector<Color> albedo_sum;
+    std::vector<Vec3> normal_sum;
+    std::vector<double> depth_sum;
+
+    Film(int w, int h)
+        : width(w), height(h), color_sum(w*h), lum_sum(w*h, 0.0), lum_sq_sum(w*h, 0.0), samples(w*h, 0) {}
+
+    void enable_aovs() {
+        albedo_sum.assign(width * height, Color());
+        normal_sum.assign(width * height, Vec3());
+        depth_sum.assign(width * height, 0.0);
+    }
+
+    bool has_aovs() const { return !albedo_sum.empty(); }
+
+    void add_sample(int idx, const Color &c, const PathInfo &info) {
+        double l = luminance(c);
+        color_sum[idx] += c;
+        lum_sum[idx] += l;
+        lum_sq_sum[idx] += l * l;
+        samples[idx]++;
+        if (has_aovs()) {
+            albedo_sum[idx] += info.albedo;
+            normal_sum[idx] += info.normal;
+            depth_sum[idx] += info.depth;
+        }
+    }
+
+    // variance of the mean luminance of a pixel
+    double mean_variance(int idx) const {
+        int n = samples[idx];
+        if (n < 2) return 0.0;
+        double mean = lum_sum[idx] / n;
+        return fmax(lum_sq_sum[idx] / n - mean * mean, 0.0) / (n - 1);
+    }
+
+    // the mean color of every pixel
+    std::vector<Color> resolve() const {
+        std::vector<Color> image(width * height);
+        for (int idx = 0; idx < width * height; idx++) {
+            image[idx] = color_sum[idx] / std::max(samples[idx], 1);
+        }
+        return image;
+    }
+
+    // relative standard error of the mean luminance of a pixel
+    double noise(int idx) const {
+        int n = samples[idx];
+        if (n < 2) return infinity;
+        double mean = lum_sum[idx] / n;
+        // the floor keeps nearly black pixels from never converging
+        return sqrt(mean_variance(idx)) / fmax(mean, 0.05);
+    }
+};
+
+typedef std::chrono::steady_clock RenderClock;
+
+inline double seconds_since(RenderClock::time_point start) {
+    return std::chrono::duration<double>(RenderClock::now() - start).count();
+}
+
+inline double seconds_until(RenderClock::time_point end) {
+    return std::chrono::duration<double>(end - RenderClock::now()).count();
+}
+
+inline RenderClock::time_point seconds_after(RenderClock::time_point start, double seconds) {
+    return start + std::chrono::duration_cast<RenderClock::duration>(std::chrono::duration<double>(seconds));
+}
+
+// rough wall-clock seconds to write one image, measured for the text ppm, the slowest format
+inline double output_seconds(int n_pixels) {
+    return 1.5e-7 * n_pixels;
+}
+
+struct RenderSettings {
+    Integrator integrator = Integrator::path;
+    int threads = 1;
+    // the samples are reproducible for the same seed and number of threads
+    unsigned int seed = 0;
+
+    // budget, a value <= 0 disables the corresponding limit
+    // wall-clock seconds for the whole run
+    double time_limit = 0.0;
+    // when the time limit runs out, main() counts it from before the acceleration structure
+    // is built; left at its default, it is counted from the start of render()
+    RenderClock::time_point deadline;
+    // seconds kept back before the deadline for the work after render(), like denoising
+    // and writing the images
+    double reserve_seconds = 0.0;
+    // stop sampling a pixel once its noise() drops below this value
+    double target_noise = 0.0;
+    // upper bounds, also used as is when there is no time limit
+    int max_samples = 500;
+    int max_depth = 50;
+    // a pixel is never considered converged with fewer samples
+    int min_adaptive_samples = 16;
+};
+
+struct RenderStats {
+    int depth = 0;
+    int planned_samples = 0;
+    int passes = 0;
+    int min_samples = 0;
+    int max_samples = 0;
+    double mean_samples = 0.0;
+    double rays_per_second = 0.0;
+    double seconds = 0.0;
+    bool deadline_hit = false;
+};
+
+// result of shooting a few paths before rendering
+struct Calibration {
+    int paths = 0;
+    long long rays = 0;
+    double seconds = 0.0;
+    // bounce_hist[b] is the number of paths that hit b surfaces
+    std::vector<int> bounce_hist;
+
+    double rays_per_second() const {
+        return seconds > 0.0 ? rays / seconds : 0.0;
+    }
+
+    // smallest depth that truncates at most the given fraction of the paths
+    int depth_for(double tolerance) const {
+        int truncated = paths;
+        for (int d = 0; d < (int)bounce_hist.size(); d++) {
+            // a path with b bounces is truncated by any depth <= b
+            truncated -= bounce_hist[d];
+            if (truncated <= tolerance * paths) return d + 1;
+        }
+        return (int)bounce_hist.size();
+    }
+
+    // average number of rays traced per sample when rendering with the given depth
+    double rays_per_sample(int depth) const {
+        if (paths == 0) return depth;
+        long long rays = 0;
+        for (int b = 0; b < (int)bounce_hist.size(); b++) {
+            rays += (long long)bounce_hist[b] * std::min(b + 1, depth);
+        }
+        return double(rays) / paths;
+    }
+};
+
+// trace paths through random points of the image for the given number of seconds,
+// on every thread at once, so that the rate includes what the threads share (cores, caches)
+// the normal integrator records no bounces, each of its paths is a single ray
+Calibration calibrate(
+    const Camera &camera, const HitTable &world, Integrator integrator, int max_depth, double seconds,
+    int min_paths, int threads = 1, unsigned int seed = 0
+) {
+    std::vector<Calibration> parts(threads);
+    RenderClock::time_point start = RenderClock::now();
+
+    auto trace_paths = [&](int t) {
+        std::seed_seq seq{seed, static_cast<unsigned int>(t)};
+        seed_random(seq);
+        Calibration &cal = parts[t];
+        cal.bounce_hist.assign(max_depth + 1, 0);
+        while (true) {
+            // check the clock every few paths only
+            if (cal.paths >= min_paths && cal.paths % 64 == 0 && seconds_since(start) >= seconds) break;
+
+            double u = rand_double();
+            double v = rand_double();
+            PathInfo info;
+            integrate(integrator, camera.get_ray(u, v), world, max_depth, &info);
+            cal.bounce_hist[info.bounces]++;
+            cal.rays += std::min(info.bounces + 1, max_depth);
+            cal.paths++;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++) workers.emplace_back(trace_paths, t);
+    trace_paths(0);
+    for (std::thread &worker : workers) worker.join();
+
+    Calibration cal;
+    cal.bounce_hist.assign(max_depth + 1, 0);
+    for (const Calibration &part : parts) {
+        cal.paths += part.paths;
+        cal.rays += part.rays;
+        for (int b = 0; b <= max_depth; b++) cal.bounce_hist[b] += part.bounce_hist[b];
+    }
+    cal.seconds = seconds_since(start);
+    return cal;
+}
+
+void sample_pixel(
+    const Camera &camera, const HitTable &world, Film &film, int i, int j, Integrator integrator, int depth
+) {
+    double u = (j + rand_double()) / (film.width - 1);
+    double v = (i + rand_double()) / (film.height - 1);
+    Ray r = camera.get_ray(u, v);
+    PathInfo info;
+    Color c = integrate(integrator, r, world, depth, &info);
+    film.add_sample(i * film.width + j, c, info);
+}
+
+// render progressively, one sample per pixel per pass, until the maximum number of
+// samples is reached, every pixel meets the noise target, or the next pass would
+// miss the deadline
+// the first pass always completes, so each pixel ends up with at least one sample
+// the lines of the image are interleaved among the threads
+RenderStats render(const Camera &camera, const HitTable &world, Film &film, const RenderSettings &settings) {
+    RenderStats stats;
+    RenderClock::time_point start = RenderClock::now();
+    int n_pixels = film.width * film.height;
+    bool timed = settings.time_limit > 0.0;
+    int n_threads = std::max(1, settings.threads);
+    RenderClock::time_point deadline = settings.deadline == RenderClock::time_point()
+        ? seconds_after(start, settings.time_limit) : settings.deadline;
+    deadline = seconds_after(deadline, -settings.reserve_seconds);
+
+    stats.depth = settings.max_depth;
+    stats.planned_samples = settings.max_samples;
+
+    if (timed) {
+        // spend a small part of the budget on measuring the scene
+        Calibration cal = calibrate(
+            camera, world, settings.integrator, settings.max_depth, fmin(0.03 * settings.time_limit, 1.0), 256,
+            n_threads, settings.seed
+        );
+        stats.rays_per_second = cal.rays_per_second();
+        double remaining = seconds_until(deadline);
+
+        // prefer an almost unbiased depth, fall back to shallower paths
+        // when that would leave too few samples per pixel
+        // the normal integrator traces one ray per sample whatever the depth
+        bool paths = settings.integrator == Integrator::path;
+        int deep = paths ? std::min(cal.depth_for(0.001), settings.max_depth) : settings.max_depth;
+        int shallow = paths ? std::min(cal.depth_for(0.01), deep) : deep;
+        for (int d = deep; d >= shallow; d--) {
+            double samples_per_second = stats.rays_per_second / cal.rays_per_sample(d);
+            // leave some slack for the clock checks
+            int spp = static_cast<int>(0.9 * remaining * samples_per_second / n_pixels);
+            stats.depth = d;
+            stats.planned_samples = std::max(1, std::min(spp, settings.max_samples));
+            if (spp >= settings.min_adaptive_samples) break;
+        }
+
+        std::cerr << "Calibration: " << cal.paths << " paths, "
+                  << stats.rays_per_second / 1e6 << " Mrays/s, depth " << stats.depth
+                  << ", planned samples per pixel " << stats.planned_samples << '\n';
+    }
+
+    // with a time limit the plan is only an estimate, keep sampling while passes fit
+    int max_passes = timed ? settings.max_samples : stats.planned_samples;
+    bool adaptive = settings.target_noise > 0.0;
+    double last_pass_seconds = 0.0;
+    for (int pass = 0; pass < max_passes; pass++) {
+        double elapsed = seconds_since(start);
+        if (pass > 0 && timed && last_pass_seconds >= seconds_until(deadline)) {
+            stats.deadline_hit = true;
+            break;
+        }
+        std::cerr << "\rPass " << pass + 1 << ' ' << std::flush;
+        bool check_noise = adaptive && pass >= settings.min_adaptive_samples;
+        std::atomic<bool> deadline_hit(false);
+        std::vector<int> active(n_threads, 0);
+
+        auto render_lines = [&](int t) {
+            std::seed_seq seq{settings.seed, static_cast<unsigned int>(pass), static_cast<unsigned int>(t)};
+            seed_random(seq);
+            int n_active = 0;
+            for (int i = t; i < film.height; i += n_threads) {
+                // the estimate of the pass time can be off, so still check during the pass
+                if (pass > 0 && timed && (deadline_hit || RenderClock::now() >= deadline)) {
+                    deadline_hit = true;
+                    break;
+                }
+                for (int j = 0; j < film.width; j++) {
+                    if (check_noise && film.noise(i * film.width + j) < settings.target_noise) continue;
+                    sample_pixel(camera, world, film, i, j, settings.integrator, stats.depth);
+                    n_active++;
+                }
+            }
+            active[t] = n_active;
+        };
+
+        std::vector<std::thread> workers;
+        for (int t = 1; t < n_threads; t++) workers.emplace_back(render_lines, t);
+        render_lines(0);
+        for (std::thread &worker : workers) worker.join();
+
+        stats.deadline_hit = deadline_hit;
+        int total_active = 0;
+        for (int n : active) total_active += n;
+
+        last_pass_seconds = seconds_since(start) - elapsed;
+        stats.passes = pass + 1;
+        if (stats.deadline_hit || total_active == 0) break;
+    }
+    std::cerr << '\n';
+
+    stats.seconds = seconds_since(start);
+    long long total = 0;
+    stats.min_samples = film.samples.empty() ? 0 : film.samples[0];
+    for (int n : film.samples) {
+        total += n;
+        stats.min_samples = std::min(stats.min_samples, n);
+        stats.max_samples = std::max(stats.max_samples, n);
+    }
+    stats.mean_samples = n_pixels > 0 ? double(total) / n_pixels : 0.0;
+    return stats;
+}
+
+void print_stats(std::ostream &out, const RenderStats &stats) {
+    out << "Rendered in " << stats.seconds << " s, " << stats.passes << " passes, depth " << stats.depth
+        << (stats.deadline_hit ? " (stopped at the deadline)" : "") << '\n'
+        << "Samples per pixel: min " << stats.min_samples
+        << ", mean " << stats.mean_samples
+        << ", max " << stats.max_samples << '\n';
+}
+
+enum class ImageFormat { ppm, ppm_binary, pfm };
+
+// write a float pfm image, with 1 (grayscale) or 3 (rgb) channels per pixel
+// the negative scale means little endian, lines go from bottom to top
+void write_pfm(std::ostream &out, int width, int height, int channels, const std::vector<float> &data) {
+    out << (channels == 1 ? "Pf" : "PF") << '\n' << width << ' ' << height << "\n-1.0\n";
+    for (int i = height - 1; i >= 0; i--) {
+        for (int k = i * width * channels; k < (i + 1) * width * channels; k++) {
+            unsigned char bytes[4];
+            uint32_t bits;
+            std::memcpy(&bits, &data[k], 4);
+            for (int b = 0; b < 4; b++) bytes[b] = static_cast<unsigned char>(bits >> (8 * b));
+            out.write(reinterpret_cast<const char *>(bytes), 4);
+        }
+    }
+}
+
+// write resolved (mean) pixel colors, pfm keeps them linear
+void write_image(std::ostream &out, int width, int height, const std::vector<Color> &image,
+                 ImageFormat format = ImageFormat::ppm) {
+    if (format == ImageFormat::ppm) {
+        // ppm header
+        out << "P3\n" << width << ' ' << height << "\n255\n";
+        for (const Color &c : image) write_color(out, c);
+    } else if (format == ImageFormat::ppm_binary) {
+        out << "P6\n" << width << ' ' << height << "\n255\n";
+        for (const Color &c : image) write_color_binary(out, c);
+    } else {
+        std::vector<float> data;
+        for (const Color &c : image) {
+            for (int k = 0; k < 3; k++) data.push_back(static_cast<float>(c[k]));
+        }
+        write_pfm(out, width, height, 3, data);
+    }
+}
+
+void write_image(std::ostream &out, const Film &film, ImageFormat format = ImageFormat::ppm) {
+    write_image(out, film.width, film.height, film.resolve(), format);
+}
+
+// write the mean albedo, normal and depth of the first hits as pfm images
+void write_aovs(std::ostream &albedo_out, std::ostream &normal_out, std::ostream &depth_out, const Film &film) {
+    int n_pixels = film.width * film.height;
+    std::vector<Color> albedo(n_pixels), normal(n_pixels);
+    std::vector<float> depth(n_pixels);
+    for (int idx = 0; idx < n_pixels; idx++) {
+        double n = std::max(film.samples[idx], 1);
+        albedo[idx] = film.albedo_sum[idx] / n;
+        normal[idx] = film.normal_sum[idx] / n;
+        depth[idx] = static_cast<float>(film.depth_sum[idx] / n);
+    }
+    write_image(albedo_out, film.width, film.height, albedo, ImageFormat::pfm);
+    write_image(normal_out, film.width, film.height, normal, ImageFormat::pfm);
+    write_pfm(depth_out, film.width, film.height, 1, depth);
+}
+
+// write the per-pixel sample counts as a plain pgm image
+void write_sample_map(std::ostream &out, const Film &film) {
+    int max_n = 1;
+    for (int n : film.samples) max_n = std::max(max_n, n);
+
+    out << "P2\n" << film.width << ' ' << film.height << '\n' << std::min(max_n, 65535) << '\n';
+    for (int i = 0; i < film.height; i++) {
+        for (int j = 0; j < film.width; j++) {
+            out << std::min(film.samples[i * film.width + j], 65535) << (j + 1 < film.width ? ' ' : '\n');
+        }
+    }
+}
+
+#endif
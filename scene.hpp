@@ -0,0 +1,216 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "common.hpp"
+#include "sphere.hpp"
+#include "hittable_list.hpp"
+#include "material.hpp"
+#include "camera.hpp"
+#include "grid.hpp"
+#include "bvh.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+// everything needed to build a Camera except the aspect ratio, which comes from the image
+struct CameraSettings {
+    Point3 look_from = Point3(13, 2, 3);
+    Point3 look_at = Point3(0, 0, 0);
+    Vec3 vup = Vec3(0, 1, 0);
+    double vfov = 20.0;
+    double aperture = 0.1;
+    double focus_dist = 10.0;
+
+    Camera make_camera(double aspect_ratio) const {
+        return Camera(look_from, look_at, vup, vfov, aspect_ratio, aperture, focus_dist);
+    }
+};
+
+struct Scene {
+    HitTableList world;
+    CameraSettings camera;
+};
+
+HitTableList random_scene() {
+    HitTableList world;
+
+    shared_ptr<Material> ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            double material_selector = rand_double();
+            Point3 center(a + 0.9*rand_double(), 0.2, b + 0.9*rand_double());
+
+            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<Material> sphere_material;
+
+                // set the material ptr
+                if (material_selector < 0.8) {
+                    // diffuse material
+                    Color albedo = Color::random() * Color::random();
+                    sphere_material = make_shared<Lambertian>(albedo);
+                } else if (material_selector < 0.95) {
+                    // metal
+                    Color albedo = Color::random(0.5, 1);
+                    double fuzz = rand_double(0, 0.5);
+                    sphere_material = make_shared<Metal>(albedo, fuzz);
+                } else {
+                    // dielectric
+                    sphere_material = make_shared<Dielectric>(1.5);
+                }
+
+                // add to scene
+                world.add(make_shared<Sphere>(center, 0.2, sphere_material));
+            }
+        }
+    }
+
+    shared_ptr<Material> material1 = make_shared<Dielectric>(1.5);
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+
+    shared_ptr<Material> material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
+    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+
+    shared_ptr<Material> material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+// parse "x,y,z" into a vector
+bool parse_vec3(const std::string &s, Vec3 &v) {
+    double e[3];
+    const char *p = s.c_str();
+    for (int k = 0; k < 3; k++) {
+        char *end;
+        e[k] = strtod(p, &end);
+        if (end == p) return false;
+        if (k < 2 && *end != ',') return false;
+        p = end + (k < 2 ? 1 : 0);
+    }
+    if (*p != '\0') return false;
+    v = Vec3(e[0], e[1], e[2]);
+    return true;
+}
+
+bool parse_double(const std::string &s, double &x) {
+    char *end;
+    x = strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0';
+}
+
+bool is_camera_param(const std::string &key) {
+    return key == "look_from" || key == "look_at" || key == "vup"
+        || key == "vfov" || key == "aperture" || key == "focus_dist";
+}
+
+// set one camera parameter by name, shared by the scene files and the command line
+bool set_camera_param(CameraSettings &camera, const std::string &key, const std::string &value) {
+    if (key == "look_from") return parse_vec3(value, camera.look_from);
+    if (key == "look_at") return parse_vec3(value, camera.look_at);
+    if (key == "vup") return parse_vec3(value, camera.vup);
+    if (key == "vfov") return parse_double(value, camera.vfov);
+    if (key == "aperture") return parse_double(value, camera.aperture);
+    if (key == "focus_dist") return parse_double(value, camera.focus_dist);
+    return false;
+}
+
+// load a scene from a text file, one statement per line, '#' starts a comment
+//
+//     camera look_from=13,2,3 look_at=0,0,0 vfov=20 aperture=0.1 focus_dist=10
+//     material ground lambertian 0.5,0.5,0.5
+//     material steel metal 0.7,0.6,0.5 0.1
+//     material glass dielectric 1.5
+//     sphere 0,-1000,0 1000 ground
+//
+// on failure, error describes the first offending line
+bool load_scene(const std::string &path, Scene &scene, std::string &error) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        error = "cannot open scene file " + path;
+        return false;
+    }
+
+    std::map<std::string, shared_ptr<Material>> materials;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        std::string::size_type comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream tokens(line);
+        std::string kind;
+        if (!(tokens >> kind)) continue;
+
+        bool ok = false;
+        if (kind == "camera") {
+            std::string param;
+            ok = true;
+            while (ok && tokens >> param) {
+                std::string::size_type eq = param.find('=');
+                ok = eq != std::string::npos
+                    && set_camera_param(scene.camera, param.substr(0, eq), param.substr(eq + 1));
+            }
+        } else if (kind == "material") {
+            std::string name, type, a, b;
+            tokens >> name >> type >> a;
+            Vec3 color;
+            double x;
+            if (type == "lambertian" && parse_vec3(a, color)) {
+                materials[name] = make_shared<Lambertian>(color);
+                ok = true;
+            } else if (type == "metal" && parse_vec3(a, color) && tokens >> b && parse_double(b, x)) {
+                materials[name] = make_shared<Metal>(color, x);
+                ok = true;
+            } else if (type == "dielectric" && parse_double(a, x)) {
+                materials[name] = make_shared<Dielectric>(x);
+                ok = true;
+            }
+        } else if (kind == "sphere") {
+            std::string c, r, name;
+            tokens >> c >> r >> name;
+            Point3 center;
+            double radius;
+            if (parse_vec3(c, center) && parse_double(r, radius) && materials.count(name)) {
+                scene.world.add(make_shared<Sphere>(center, radius, materials[name]));
+                ok = true;
+            }
+        }
+
+        if (!ok) {
+            std::ostringstream msg;
+            msg << path << ':' << line_no << ": invalid " << kind << " statement";
+            error = msg.str();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// acceleration structure the rays are traced against
+enum class Accel { list, grid, bvh };
+
+shared_ptr<HitTable> build_accel(Accel accel, const HitTableList &world, int threads) {
+    switch (accel) {
+        case Accel::grid: return make_shared<UniformGrid>(world.objects, threads);
+        case Accel::bvh: return make_shared<BVH>(world.objects, threads);
+        default: return make_shared<HitTableList>(world);
+    }
+}
+
+// "random" is the built-in scene, anything else is a scene file
+bool make_scene(const std::string &name, Scene &scene, std::string &error) {
+    if (name == "random") {
+        scene.world = random_scene();
+        return true;
+    }
+    return load_scene(name, scene, error);
+}
+
+#endif
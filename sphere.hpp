@@ -10,6 +10,7 @@ class Sphere : public HitTable {
         Sphere(Point3 c, double r, shared_ptr<Material> m) : center(c), radius(r), mat_ptr(m) {}
 
         virtual bool hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+        virtual bool bounding_box(AABB &output_box) const override;
 
     public:
         Point3 center;
@@ -47,4 +48,11 @@ bool Sphere::hit(const Ray &r, double t_min, double t_max, hit_record &rec) cons
     return true;
 }
 
+bool Sphere::bounding_box(AABB &output_box) const {
+    // hollow spheres have a negative radius
+    Vec3 r(fabs(radius), fabs(radius), fabs(radius));
+    output_box = AABB(center - r, center + r);
+    return true;
+}
+
 #endif